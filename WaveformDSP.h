@@ -0,0 +1,781 @@
+// Waveform processing shared by the analysis macros
+#ifndef WAVEFORM_DSP_H
+#define WAVEFORM_DSP_H
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <fstream>
+#include <cmath>
+#include <algorithm>
+
+#include "TTree.h"
+#include "TLeaf.h"
+
+
+/* ********************************************************************************************** */
+/*                                         VECTOR HELPERS                                         */
+/* ********************************************************************************************** */
+
+inline void sum_vector(std::vector<double>& v_destination, std::vector<double>& v_toSum)
+{
+    for (int i = 0; i < v_destination.size(); i++)
+    {
+        v_destination[i] += v_toSum[i];
+    }
+}
+
+inline void sum_vector_shifted(std::vector<double>& v_destination, std::vector<double>& v_toSum, int shift)
+{
+    for (int i = 0; i < v_destination.size(); i++)
+    {
+        if ((i + shift) >= 0 && (i + shift) < v_toSum.size())
+        {
+            v_destination[i] += v_toSum[i + shift];
+        }
+    }
+}
+
+inline void divide_vector(std::vector<double>& v_destination, double divisor)
+{
+    for (int i = 0; i < v_destination.size(); i++)
+    {
+        v_destination[i] /= divisor;
+    }
+}
+
+inline void scale_vector(std::vector<double>& v, double scale)
+{
+    for (int i = 0; i < v.size(); i++)
+    {
+        v[i] *= scale;
+    }
+}
+
+/* ********************************************************************************************** */
+/*                                     SINGLE STAGE PROCESSING                                    */
+/* ********************************************************************************************** */
+
+inline void baseline_correction(std::vector<double>& v, int n_start, int n_end)
+{
+    double sum = 0;
+    for (int i = n_start; i < n_end; i++)
+    {
+        sum += v[i];
+    }
+    sum /= (n_end - n_start);
+    for (int i = 0; i < v.size(); i++)
+    {
+        v[i] -= sum;
+    }
+}
+
+inline void detrending(std::vector<double>& v, int n_start, int n_end)
+{
+    double sum_yi = 0;
+    double sum_xi = 0;
+    double sum_yixi = 0;
+    double sum_xi2 = 0;
+
+    for (int i = n_start; i < n_end; i++)
+    {
+        sum_yi += v[i];
+        sum_xi += i;
+        sum_yixi += v[i] * i;
+        sum_xi2 += i * i;
+    }
+    double avg_yi = sum_yi / (n_end - n_start);
+    double avg_xi = sum_xi / (n_end - n_start);
+    double avg_yixi = sum_yixi / (n_end - n_start);
+    double avg_xi2 = sum_xi2 / (n_end - n_start);
+
+    double cov_xy = avg_yixi - avg_yi * avg_xi;
+    double var_x = avg_xi2 - avg_xi * avg_xi;
+
+    double a = cov_xy / var_x;
+    double b = avg_yi - a * avg_xi;
+
+    for (int i = 0; i < v.size(); i++)
+    {
+        v[i] -= a * i + b;
+    }
+}
+
+inline void template_fitting(std::vector<double>& templ, std::vector<double>& wave, std::vector<double>& fit, int n_start, int n_end)
+{
+    // Fit is linear
+    // The wave is Y[k]
+    // The template is X[k]
+    // The fit is Y[k] = aX[k] + b (between the samples n_start and n_end)
+
+    double sum_yi = 0;
+    double sum_xi = 0;
+    double sum_yixi = 0;
+    double sum_xi2 = 0;
+
+    for (int i = n_start; i < n_end; i++)
+    {
+        sum_yi += wave[i];
+        sum_xi += templ[i];
+        sum_yixi += wave[i] * templ[i];
+        sum_xi2 += templ[i] * templ[i];
+    }
+
+    double avg_yi = sum_yi / (n_end - n_start);
+    double avg_xi = sum_xi / (n_end - n_start);
+    double avg_yixi = sum_yixi / (n_end - n_start);
+    double avg_xi2 = sum_xi2 / (n_end - n_start);
+
+    double cov_xy = avg_yixi - avg_yi * avg_xi;
+    double var_x = avg_xi2 - avg_xi * avg_xi;
+
+    double a = cov_xy / var_x;
+    double b = avg_yi - a * avg_xi;
+
+    fit[0] = a;
+    fit[1] = b;
+}
+
+inline int CFD_detection(std::vector<double>& v, double CFD)
+{
+    double max = v[0];
+    double min = v[0];
+
+    for (int i = 0; i < v.size(); i++)
+    {
+        if (v[i] > max)
+        {
+            max = v[i];
+        }
+        if (v[i] < min)
+        {
+            min = v[i];
+        }
+    }
+
+
+    double threshold = min + CFD * (max - min);
+
+    for (int i = 0; i < v.size(); i++)
+    {
+        if (v[i] > threshold)
+        {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+/* ********************************************************************************************** */
+/*                                        FUSED PROCESSING                                        */
+/* ********************************************************************************************** */
+/*
+baseline_correction followed by detrending on the same window [n_base_start, n_base_end) removes
+the straight line y = slope * i + intercept fitted to the raw samples of that window. The line is
+estimated with one pass over the window and never has to be subtracted from the whole record:
+the template fit subtracts it analytically from its sums,
+
+    sum(y')    = sum(y)    - slope * sum(i)    - intercept * K
+    sum(y' x)  = sum(y x)  - slope * sum(i x)  - intercept * sum(x)
+
+where sum(i), sum(x), sum(x^2) and sum(i x) only depend on the template and are computed once.
+A fit then reads the baseline window and the fit window once, in place, with no copy of the event.
+*/
+
+struct LinearBaseline{
+    double slope;               // ADC counts per sample
+    double intercept;           // ADC counts at sample 0
+};
+
+// Stage 1: straight line fitted to v[n_start ... n_end), one pass
+inline LinearBaseline estimate_baseline(const double* v, int n_start, int n_end)
+{
+    double sum_yi = 0;
+    double sum_yixi = 0;
+    for (int i = n_start; i < n_end; i++)
+    {
+        sum_yi += v[i];
+        sum_yixi += v[i] * i;
+    }
+
+    // sum of i and i^2 over the window in closed form
+    double n = n_end - n_start;
+    double avg_xi = 0.5 * (n_start + n_end - 1);
+    auto sum_squares = [](double m) { return m * (m + 1) * (2 * m + 1) / 6; };
+    double sum_xi2 = sum_squares(n_end - 1) - sum_squares(n_start - 1);
+
+    double avg_yi = sum_yi / n;
+    double cov_xy = sum_yixi / n - avg_yi * avg_xi;
+    double var_x = sum_xi2 / n - avg_xi * avg_xi;
+
+    LinearBaseline baseline;
+    baseline.slope = cov_xy / var_x;
+    baseline.intercept = avg_yi - baseline.slope * avg_xi;
+    return baseline;
+}
+
+// Stage 2 (only when the corrected samples are needed): subtract the line in place, one pass
+inline void subtract_baseline(double* v, int n, const LinearBaseline& baseline)
+{
+    for (int i = 0; i < n; i++)
+    {
+        v[i] -= baseline.slope * i + baseline.intercept;
+    }
+}
+
+// Same result as baseline_correction + detrending on the same window, in two passes instead of four
+inline void baseline_detrend(std::vector<double>& v, int n_start, int n_end)
+{
+    subtract_baseline(&v[0], v.size(), estimate_baseline(&v[0], n_start, n_end));
+}
+
+class TemplateFitter
+{
+public:
+    // Template fit between n_start and n_end, after the linear baseline of [n_base_start, n_base_end)
+    TemplateFitter(const std::vector<double>& templ, int n_base_start, int n_base_end, int n_start, int n_end);
+
+    // Stage 3: fit[0] = a, fit[1] = b of the corrected wave, the wave is not modified
+    void fit(const double* wave, const LinearBaseline& baseline, double* fit);
+    // Stages 1 + 3: same result as baseline_correction, detrending and template_fitting
+    void fit(const double* wave, double* fit);
+
+private:
+    std::vector<double> templ;
+    int n_base_start;
+    int n_base_end;
+    int n_start;
+    int n_end;
+
+    double sum_i;               // Template constants over the fit window
+    double sum_x;
+    double sum_x2;
+    double sum_ix;
+};
+
+inline TemplateFitter::TemplateFitter(const std::vector<double>& templ, int n_base_start, int n_base_end, int n_start, int n_end)
+    : templ(templ), n_base_start(n_base_start), n_base_end(n_base_end), n_start(n_start), n_end(n_end)
+{
+    sum_i = 0;
+    sum_x = 0;
+    sum_x2 = 0;
+    sum_ix = 0;
+    for (int i = n_start; i < n_end; i++)
+    {
+        sum_i += i;
+        sum_x += templ[i];
+        sum_x2 += templ[i] * templ[i];
+        sum_ix += i * templ[i];
+    }
+}
+
+inline void TemplateFitter::fit(const double* wave, const LinearBaseline& baseline, double* fit)
+{
+    const double* x = templ.data();
+    double sum_yi = 0;
+    double sum_yixi = 0;
+    for (int i = n_start; i < n_end; i++)
+    {
+        sum_yi += wave[i];
+        sum_yixi += wave[i] * x[i];
+    }
+
+    double n = n_end - n_start;
+    sum_yi -= baseline.slope * sum_i + baseline.intercept * n;
+    sum_yixi -= baseline.slope * sum_ix + baseline.intercept * sum_x;
+
+    double avg_yi = sum_yi / n;
+    double avg_xi = sum_x / n;
+    double avg_yixi = sum_yixi / n;
+    double avg_xi2 = sum_x2 / n;
+
+    double cov_xy = avg_yixi - avg_yi * avg_xi;
+    double var_x = avg_xi2 - avg_xi * avg_xi;
+
+    fit[0] = cov_xy / var_x;
+    fit[1] = avg_yi - fit[0] * avg_xi;
+}
+
+inline void TemplateFitter::fit(const double* wave, double* fit)
+{
+    this -> fit(wave, estimate_baseline(wave, n_base_start, n_base_end), fit);
+}
+
+/* ********************************************************************************************** */
+/*                                       STREAMING TEMPLATE                                       */
+/* ********************************************************************************************** */
+/*
+Template built while the events stream by (e.g. during DigitizerCAEN::readWaves) with the cuts and
+the CFD alignment of GetTemplate_v02. Each accepted event is shifted so that its CFD trigger falls
+at postTrigger * recordLength, and enters a running mean and variance per sample (Welford):
+
+    n += 1,    delta = x - mean,    mean += delta / n,    m2 += delta * (x - mean)
+
+Builders filled on different chunks of a file are combined in chunk order (Chan et al.),
+
+    mean = mean_a + delta * n_b / n,    m2 = m2_a + m2_b + delta^2 * n_a * n_b / n
+
+with delta = mean_b - mean_a, so the template never needs a second pass over the events.
+As in sum_vector_shifted, the samples shifted in from outside the record count as 0.
+
+Optional outlier cut (outlierSigma > 0): once outlierWarmUp events are accepted, an aligned
+event is rejected if the RMS over the samples of (x - mean) / sigma exceeds outlierSigma, with
+the running mean and sigma (samples with sigma = 0 are skipped). Each chunk warms up on its own
+events, so with the cut on the template depends on how the file is split.
+*/
+
+struct TemplateCuts{
+    double postTrigger = 0.5;           // Expected trigger position, fraction of the record
+    double CFD_fraction = 0.4;          // CFD threshold, fraction of the event amplitude
+    double minTrigger = 0.4;            // Rejected if triggering before minTrigger * expected position
+    double saturation = 14000;          // Rejected if the maximum is above (ADC counts)
+    double lowSignal = 7000;            // Rejected if the maximum is below (ADC counts)
+    double outlierSigma = 0;            // Rejected if further from the running mean (RMS, in sigma); 0 = no cut
+    long outlierWarmUp = 100;           // Accepted events before the outlier cut applies (at least 2)
+};
+
+class TemplateBuilder
+{
+public:
+    // recordLength = 0: taken from the first event
+    TemplateBuilder(const TemplateCuts& cuts = TemplateCuts(), int recordLength = 0);
+
+    // Cuts, CFD alignment and accumulation of one event; returns true if the event is accepted
+    template<class T> bool add(const T* wave, int n);
+    // Add the events of other, as if they had been added after the events of this builder
+    void merge(const TemplateBuilder& other);
+
+    long getAccepted() const {return n_accepted;};
+    long getRejected() const {return n_trigger + n_saturation + n_lowSignal + n_length + n_outlier;};
+    long getRejectedTrigger() const {return n_trigger;};
+    long getRejectedSaturation() const {return n_saturation;};
+    long getRejectedLowSignal() const {return n_lowSignal;};
+    long getRejectedLength() const {return n_length;};
+    long getRejectedOutlier() const {return n_outlier;};
+    int getRecordLength() const {return recordLength;};
+    const TemplateCuts& getCuts() const {return cuts;};
+
+    // Running mean and standard deviation of the aligned events, in ADC counts
+    const std::vector<double>& getMean() const {return mean;};
+    std::vector<double> getSigma() const;
+
+    // Post-processing of GetTemplate_v02: linear baseline of [discard_pts + 1, n_base_end) removed,
+    // first discard_pts samples and tail from the first negative sample after the trigger set to 0,
+    // peak normalised to 1. sigma (if given) gets the sigma band with the same normalisation.
+    // Empty (with an error message) if no event was accepted or the peak is not positive.
+    std::vector<double> getTemplate(int discard_pts = 200, int n_base_end = 1000, std::vector<double>* sigma = nullptr) const;
+    // One value per line, the format read by readTemplate. Returns false if there is no template.
+    bool write(const std::string& templateFilename, const std::string& sigmaFilename, int discard_pts = 200, int n_base_end = 1000) const;
+
+private:
+    TemplateCuts cuts;
+    int recordLength;
+    int n_trigger_expected;             // Sample where the aligned triggers fall
+
+    long n_accepted = 0;
+    long n_trigger = 0;                 // Rejected: trigger not found or too early
+    long n_saturation = 0;              // Rejected: saturated
+    long n_lowSignal = 0;               // Rejected: amplitude too low
+    long n_length = 0;                  // Rejected: record length different from the template
+    long n_outlier = 0;                 // Rejected: too far from the running mean
+
+    std::vector<double> mean;
+    std::vector<double> m2;             // Sum of squared deviations from the mean
+
+    void setRecordLength(int n);
+};
+
+inline TemplateBuilder::TemplateBuilder(const TemplateCuts& cuts, int recordLength)
+    : cuts(cuts)
+{
+    setRecordLength(recordLength);
+}
+
+inline void TemplateBuilder::setRecordLength(int n)
+{
+    recordLength = n;
+    n_trigger_expected = (int) std::floor(n * cuts.postTrigger);
+    mean.assign(n, 0.);
+    m2.assign(n, 0.);
+}
+
+template<class T>
+inline bool TemplateBuilder::add(const T* wave, int n)
+{
+    if (recordLength == 0 && n_accepted == 0)
+    {
+        setRecordLength(n);
+    }
+    if (n != recordLength || n == 0)
+    {
+        n_length++;
+        return false;
+    }
+
+    // Amplitude for the cuts and the CFD threshold, then the first sample above threshold
+    double max = wave[0];
+    double min = wave[0];
+    for (int i = 0; i < n; i++)
+    {
+        max = std::max(max, (double) wave[i]);
+        min = std::min(min, (double) wave[i]);
+    }
+    double threshold = min + cuts.CFD_fraction * (max - min);
+    int index_Trigger = -1;
+    for (int i = 0; i < n; i++)
+    {
+        if (wave[i] > threshold)
+        {
+            index_Trigger = i;
+            break;
+        }
+    }
+
+    if (index_Trigger < n_trigger_expected * cuts.minTrigger)
+    {
+        n_trigger++;
+        return false;
+    }
+    if (max > cuts.saturation)
+    {
+        n_saturation++;
+        return false;
+    }
+    if (max < cuts.lowSignal)
+    {
+        n_lowSignal++;
+        return false;
+    }
+
+    // Sample i of the template is sample i + shift of the event
+    int shift = index_Trigger - n_trigger_expected;
+    int i_first = std::max(0, -shift);
+    int i_last = std::min(n, n - shift);
+    auto aligned = [&](int i) {
+        return (i >= i_first && i < i_last) ? (double) wave[i + shift] : 0.;
+    };
+
+    if (cuts.outlierSigma > 0 && n_accepted >= std::max(cuts.outlierWarmUp, 2L))
+    {
+        double chi2 = 0;
+        int n_used = 0;
+        for (int i = 0; i < n; i++)
+        {
+            double var = m2[i] / (n_accepted - 1);
+            if (var > 0)
+            {
+                double delta = aligned(i) - mean[i];
+                chi2 += delta * delta / var;
+                n_used++;
+            }
+        }
+        if (n_used > 0 && chi2 > cuts.outlierSigma * cuts.outlierSigma * n_used)
+        {
+            n_outlier++;
+            return false;
+        }
+    }
+
+    n_accepted++;
+    double inv_n = 1. / n_accepted;
+    for (int i = 0; i < n; i++)
+    {
+        double x = aligned(i);
+        double delta = x - mean[i];
+        mean[i] += delta * inv_n;
+        m2[i] += delta * (x - mean[i]);
+    }
+    return true;
+}
+
+inline void TemplateBuilder::merge(const TemplateBuilder& other)
+{
+    n_trigger += other.n_trigger;
+    n_saturation += other.n_saturation;
+    n_lowSignal += other.n_lowSignal;
+    n_length += other.n_length;
+    n_outlier += other.n_outlier;
+    if (other.n_accepted == 0)
+    {
+        return;
+    }
+    if (n_accepted == 0)
+    {
+        recordLength = other.recordLength;
+        n_trigger_expected = other.n_trigger_expected;
+        mean = other.mean;
+        m2 = other.m2;
+        n_accepted = other.n_accepted;
+        return;
+    }
+    if (other.recordLength != recordLength)
+    {
+        // Events of a different record length cannot be combined
+        n_length += other.n_accepted;
+        return;
+    }
+
+    double n_a = n_accepted;
+    double n_b = other.n_accepted;
+    double n = n_a + n_b;
+    for (int i = 0; i < recordLength; i++)
+    {
+        double delta = other.mean[i] - mean[i];
+        mean[i] += delta * n_b / n;
+        m2[i] += other.m2[i] + delta * delta * n_a * n_b / n;
+    }
+    n_accepted += other.n_accepted;
+}
+
+inline std::vector<double> TemplateBuilder::getSigma() const
+{
+    std::vector<double> sigma(recordLength, 0.);
+    if (n_accepted > 1)
+    {
+        for (int i = 0; i < recordLength; i++)
+        {
+            sigma[i] = std::sqrt(m2[i] / (n_accepted - 1));
+        }
+    }
+    return sigma;
+}
+
+inline std::vector<double> TemplateBuilder::getTemplate(int discard_pts, int n_base_end, std::vector<double>* sigma) const
+{
+    std::vector<double> templ = mean;
+    if (sigma != nullptr)
+    {
+        *sigma = getSigma();
+    }
+    if (n_accepted == 0)
+    {
+        std::cout << "Error: no event accepted, no template" << std::endl;
+        templ.clear();
+        if (sigma != nullptr)
+        {
+            sigma -> clear();
+        }
+        return templ;
+    }
+
+    n_base_end = std::min(n_base_end, recordLength);
+    if (n_base_end - (discard_pts + 1) >= 2)
+    {
+        baseline_detrend(templ, discard_pts + 1, n_base_end);
+    }
+    for (int i = 0; i < discard_pts && i < recordLength; i++)
+    {
+        templ[i] = 0;
+    }
+
+    // The cuts and the alignment assume positive pulses: a peak <= 0 cannot be normalised
+    double max = *std::max_element(templ.begin(), templ.end());
+    if (!(max > 0))
+    {
+        std::cout << "Error: the template peak is " << max << " (negative polarity?), no template" << std::endl;
+        templ.clear();
+        if (sigma != nullptr)
+        {
+            sigma -> clear();
+        }
+        return templ;
+    }
+    scale_vector(templ, 1.0 / max);
+    if (sigma != nullptr)
+    {
+        scale_vector(*sigma, 1.0 / max);
+    }
+
+    // Tail cut at the first negative sample after the trigger
+    for (int i = n_trigger_expected; i < recordLength; i++)
+    {
+        if (templ[i] < 0)
+        {
+            std::fill(templ.begin() + i, templ.end(), 0.);
+            break;
+        }
+    }
+    return templ;
+}
+
+// Template and sigma band, one value per line. Returns false (and writes nothing) if templ is empty.
+inline bool writeTemplate(const std::vector<double>& templ, const std::vector<double>& sigma,
+                          const std::string& templateFilename, const std::string& sigmaFilename)
+{
+    if (templ.empty() || sigma.size() != templ.size())
+    {
+        return false;
+    }
+    std::ofstream file_templ(templateFilename);
+    std::ofstream file_sigma(sigmaFilename);
+    for (size_t i = 0; i < templ.size(); i++)
+    {
+        file_templ << templ[i] << std::endl;
+        file_sigma << sigma[i] << std::endl;
+    }
+    return file_templ.good() && file_sigma.good();
+}
+
+inline bool TemplateBuilder::write(const std::string& templateFilename, const std::string& sigmaFilename, int discard_pts, int n_base_end) const
+{
+    std::vector<double> sigma;
+    std::vector<double> templ = getTemplate(discard_pts, n_base_end, &sigma);
+    return writeTemplate(templ, sigma, templateFilename, sigmaFilename);
+}
+
+/* ********************************************************************************************** */
+/*                                         TEMPLATE FILES                                         */
+/* ********************************************************************************************** */
+
+// One sample per line, as written by GetTemplate, GetTemplate_v02 and TemplateBuilder::write
+inline std::vector<double> readTemplate(const std::string& path)
+{
+    std::vector<double> templ;
+    std::ifstream file_template(path);
+    if (!file_template.is_open())
+    {
+        std::cout << "Error: the template file " << path << " could not be opened" << std::endl;
+        return templ;
+    }
+    double value;
+    while (file_template >> value)
+    {
+        templ.push_back(value);
+    }
+    return templ;
+}
+
+/* ********************************************************************************************** */
+/*                                         WAVEFORM READER                                        */
+/* ********************************************************************************************** */
+/*
+The waveform branch of the waves tree is double, or UShort_t when the file was converted with
+DigitizerCAEN::setRawSamples. WaveformReader binds the branch with the type it has in the file
+and always gives the waveform as double, so that the macros read both storages:
+
+    WaveformReader reader(waves);
+    std::vector<double>& waveform = reader.getWaveform();
+    for (Long64_t i = 0; i < waves -> GetEntries(); i++)
+    {
+        reader.GetEntry(i);
+        ... waveform ...
+    }
+
+The branch addresses point into the reader: it cannot be copied.
+*/
+
+class WaveformReader
+{
+public:
+    // The record length (and the size of the waveform) is taken from entry 0
+    explicit WaveformReader(TTree* waves);
+    WaveformReader(const WaveformReader&) = delete;
+    WaveformReader& operator=(const WaveformReader&) = delete;
+
+    // Entry i of the tree, UShort_t samples converted to double
+    int GetEntry(Long64_t i);
+
+    std::vector<double>& getWaveform(){return waveform;};
+    int getRecordLength(){return recordLength;};
+    bool getRaw(){return raw;};
+
+private:
+    TTree* waves;
+    int recordLength = 0;
+    bool raw = false;
+    std::vector<double> waveform;
+    std::vector<UShort_t> waveform_raw;
+};
+
+inline WaveformReader::WaveformReader(TTree* waves)
+    : waves(waves)
+{
+    TLeaf* leaf = waves -> GetLeaf("waveform");
+    raw = leaf != nullptr && std::string(leaf -> GetTypeName()) == "UShort_t";
+
+    waves -> SetBranchAddress("recordLength", &recordLength);
+    if (waves -> GetEntries() == 0)
+    {
+        return;
+    }
+    waves -> GetEntry(0);
+    waveform.resize(recordLength);
+    if (raw)
+    {
+        waveform_raw.resize(recordLength);
+        waves -> SetBranchAddress("waveform", &waveform_raw[0]);
+    }
+    else
+    {
+        waves -> SetBranchAddress("waveform", &waveform[0]);
+    }
+}
+
+inline int WaveformReader::GetEntry(Long64_t i)
+{
+    int n = waves -> GetEntry(i);
+    if (raw)
+    {
+        std::copy(waveform_raw.begin(), waveform_raw.end(), waveform.begin());
+    }
+    return n;
+}
+
+/* ********************************************************************************************** */
+/*                                      TEMPLATE FROM A TTREE                                     */
+/* ********************************************************************************************** */
+
+inline void ExtractTemplate(TTree* waves, std::vector<double> & templ)
+{
+    if (waves -> GetEntries() == 0)
+    {
+        std::cout << "Error: no waves to extract the template from" << std::endl;
+        templ.clear();
+        return;
+    }
+    WaveformReader reader(waves);
+    std::vector<double>& waveform = reader.getWaveform();
+    std::vector<double> waveform_avg(reader.getRecordLength());
+
+    for (int i = 0; i < waves -> GetEntries(); i++)
+    {
+        reader.GetEntry(i);
+        sum_vector(waveform_avg, waveform);
+    }
+
+    divide_vector(waveform_avg, waves -> GetEntries());
+    baseline_detrend(waveform_avg, 0, 1500);
+
+    double max = waveform_avg[0];
+    double min = waveform_avg[0];
+    for (int i = 0; i < waveform_avg.size(); i++)
+    {
+        if (waveform_avg[i] > max)
+        {
+            max = waveform_avg[i];
+        }
+        if (waveform_avg[i] < min)
+        {
+            min = waveform_avg[i];
+        }
+    }
+
+    // Determine the polarity of the waveform
+    // If the maximum is the most distant from 0, the polarity is positive
+    // If the minimum is the most distant from 0, the polarity is negative
+
+    if (max > -min)
+    {
+        scale_vector(waveform_avg, 1/ max);
+    }
+    else
+    {
+        scale_vector(waveform_avg, -1/ min);
+    }
+
+    templ = waveform_avg;
+
+}
+
+#endif